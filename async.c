@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "async.h"
+
+/*
+  A pool of worker threads executes jobs. Each state with pending jobs
+  has a queue of jobs. A queue is in the run list only when it is not
+  being executed, such that jobs on the same state are executed in
+  order, one at a time. Jobs on different states run in parallel.
+
+  Everything is protected by a single mutex: jobs are expected to be
+  large (hashing whole tensors).
+*/
+
+#define LHASYNC_MAXTHREADS 16
+
+struct LHAsyncJob_ {
+  LHAsyncWork work;
+  LHAsyncRelease release;
+  void *data;
+  int done;
+  unsigned long long digest;
+  struct LHAsyncJob_ *next;
+};
+
+typedef struct LHAsyncQueue_ {
+  LHHash *state;
+  LHAsyncJob *head;
+  LHAsyncJob *tail;
+  struct LHAsyncQueue_ *next;    /* in the run list */
+  struct LHAsyncQueue_ *pending; /* in the list of queues */
+} LHAsyncQueue;
+
+static pthread_mutex_t LHAsync_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t LHAsync_workcond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t LHAsync_donecond = PTHREAD_COND_INITIALIZER;
+static int LHAsync_nthreads = 0;
+static LHAsyncQueue *LHAsync_runhead = NULL;
+static LHAsyncQueue *LHAsync_runtail = NULL;
+static LHAsyncQueue *LHAsync_queues = NULL;
+
+static void LHAsync_schedule(LHAsyncQueue *queue)
+{
+  queue->next = NULL;
+  if(LHAsync_runtail)
+    LHAsync_runtail->next = queue;
+  else
+    LHAsync_runhead = queue;
+  LHAsync_runtail = queue;
+  pthread_cond_signal(&LHAsync_workcond);
+}
+
+static LHAsyncQueue* LHAsync_find(LHHash *state)
+{
+  LHAsyncQueue *queue = LHAsync_queues;
+  while(queue && queue->state != state)
+    queue = queue->pending;
+  return queue;
+}
+
+static void LHAsync_remove(LHAsyncQueue *queue)
+{
+  LHAsyncQueue **ptr = &LHAsync_queues;
+  while(*ptr != queue)
+    ptr = &(*ptr)->pending;
+  *ptr = queue->pending;
+}
+
+static void* LHAsync_worker(void *arg)
+{
+  (void)arg;
+  pthread_mutex_lock(&LHAsync_mutex);
+  for(;;) {
+    LHAsyncQueue *queue = NULL;
+    LHAsyncJob *job = NULL;
+    unsigned long long digest;
+
+    while(!LHAsync_runhead)
+      pthread_cond_wait(&LHAsync_workcond, &LHAsync_mutex);
+    queue = LHAsync_runhead;
+    LHAsync_runhead = queue->next;
+    if(!LHAsync_runhead)
+      LHAsync_runtail = NULL;
+    job = queue->head;
+    pthread_mutex_unlock(&LHAsync_mutex);
+
+    job->work(queue->state, job->data);
+    digest = LHHash_digest(queue->state);
+    if(job->release)
+      job->release(job->data);
+
+    pthread_mutex_lock(&LHAsync_mutex);
+    job->digest = digest;
+    job->done = 1;
+    queue->head = job->next;
+    if(queue->head)
+      LHAsync_schedule(queue);
+    else {
+      LHAsync_remove(queue);
+      free(queue);
+    }
+    pthread_cond_broadcast(&LHAsync_donecond);
+  }
+  return NULL;
+}
+
+/* must be called with the mutex held */
+static int LHAsync_init(void)
+{
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  int nthreads = (int)(ncpu < 1 ? 1 : (ncpu > LHASYNC_MAXTHREADS ? LHASYNC_MAXTHREADS : ncpu));
+  int i;
+
+  for(i = 0; i < nthreads; i++) {
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, LHAsync_worker, NULL))
+      break;
+    pthread_detach(thread);
+    LHAsync_nthreads++;
+  }
+  return LHAsync_nthreads > 0;
+}
+
+LHAsyncJob* LHAsync_update(LHHash *state, LHAsyncWork work, LHAsyncRelease release, void *data)
+{
+  LHAsyncJob *job = NULL;
+  LHAsyncQueue *queue = NULL;
+
+  pthread_mutex_lock(&LHAsync_mutex);
+
+  if(!LHAsync_nthreads && !LHAsync_init())
+    goto cleanup;
+
+  job = (LHAsyncJob*)malloc(sizeof(LHAsyncJob));
+  if(!job)
+    goto cleanup;
+  job->work = work;
+  job->release = release;
+  job->data = data;
+  job->done = 0;
+  job->digest = 0;
+  job->next = NULL;
+
+  queue = LHAsync_find(state);
+  if(queue) {
+    /* the queue is either scheduled, or running (and will be rescheduled) */
+    queue->tail->next = job;
+    queue->tail = job;
+  }
+  else {
+    queue = (LHAsyncQueue*)malloc(sizeof(LHAsyncQueue));
+    if(!queue) {
+      free(job);
+      job = NULL;
+      goto cleanup;
+    }
+    queue->state = state;
+    queue->head = job;
+    queue->tail = job;
+    queue->pending = LHAsync_queues;
+    LHAsync_queues = queue;
+    LHAsync_schedule(queue);
+  }
+
+cleanup:
+  pthread_mutex_unlock(&LHAsync_mutex);
+  return job;
+}
+
+int LHAsync_ready(LHAsyncJob *job)
+{
+  int done;
+  pthread_mutex_lock(&LHAsync_mutex);
+  done = job->done;
+  pthread_mutex_unlock(&LHAsync_mutex);
+  return done;
+}
+
+void LHAsync_wait(LHAsyncJob *job)
+{
+  pthread_mutex_lock(&LHAsync_mutex);
+  while(!job->done)
+    pthread_cond_wait(&LHAsync_donecond, &LHAsync_mutex);
+  pthread_mutex_unlock(&LHAsync_mutex);
+}
+
+unsigned long long LHAsync_digest(LHAsyncJob *job)
+{
+  LHAsync_wait(job);
+  return job->digest;
+}
+
+void LHAsync_free(LHAsyncJob *job)
+{
+  LHAsync_wait(job);
+  free(job);
+}
+
+void LHAsync_sync(LHHash *state)
+{
+  pthread_mutex_lock(&LHAsync_mutex);
+  while(LHAsync_find(state))
+    pthread_cond_wait(&LHAsync_donecond, &LHAsync_mutex);
+  pthread_mutex_unlock(&LHAsync_mutex);
+}
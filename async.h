@@ -0,0 +1,26 @@
+#ifndef LIBHASH_ASYNC_INC
+#define LIBHASH_ASYNC_INC
+
+#include "hash.h"
+
+typedef struct LHAsyncJob_ LHAsyncJob;
+
+/* updates the given state with data, called from a worker thread */
+typedef void (*LHAsyncWork)(LHHash *state, void *data);
+/* releases data once hashed, called from a worker thread */
+typedef void (*LHAsyncRelease)(void *data);
+
+/* jobs on the same state are executed in order; returns NULL on failure
+   (release is then not called) */
+LHAsyncJob* LHAsync_update(LHHash *state, LHAsyncWork work, LHAsyncRelease release, void *data);
+int LHAsync_ready(LHAsyncJob *job);
+void LHAsync_wait(LHAsyncJob *job);
+/* digest of the state right after the job (waits for it) */
+unsigned long long LHAsync_digest(LHAsyncJob *job);
+/* waits for the job, then frees it */
+void LHAsync_free(LHAsyncJob *job);
+
+/* waits for all pending jobs on the given state */
+void LHAsync_sync(LHHash *state);
+
+#endif
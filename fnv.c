@@ -63,12 +63,32 @@ static void FNV64_free(LHHash* state)
   free(state);
 };
 
+static size_t FNV64_export(LHHash *state_in, unsigned char *buffer)
+{
+  LHFNV64Hash *state = (LHFNV64Hash*)state_in;
+  if(buffer)
+    LHHash_writeU64(buffer, state->hval);
+  return 8;
+}
+
+static int FNV64_import(LHHash *state_in, const unsigned char *buffer, size_t len)
+{
+  LHFNV64Hash *state = (LHFNV64Hash*)state_in;
+  if(len != 8)
+    return 0;
+  state->hval = LHHash_readU64(buffer);
+  return 1;
+}
+
 static struct LHHashVTable LHFNV64VTable = {
   FNV64_reset,
   FNV64_update,
   FNV64_digest,
   FNV64_clone,
-  FNV64_free
+  FNV64_free,
+  FNV64_export,
+  FNV64_import,
+  LHHASH_FNV64
 };
 
 LHHash* LHFNV64_new(void)
@@ -25,3 +25,61 @@ void LHHash_free(LHHash* state)
 {
   state->vtable->free(state);
 }
+
+void LHHash_writeU64(unsigned char *buffer, unsigned long long value)
+{
+  int i;
+  for(i = 0; i < 8; i++)
+    buffer[i] = (unsigned char)(value >> (8*i));
+}
+
+unsigned long long LHHash_readU64(const unsigned char *buffer)
+{
+  unsigned long long value = 0;
+  int i;
+  for(i = 0; i < 8; i++)
+    value |= ((unsigned long long)buffer[i]) << (8*i);
+  return value;
+}
+
+/*
+  layout: 'L' 'H' version type, followed by the state of the hash
+  (stored in little-endian, regardless of the architecture)
+*/
+size_t LHHash_export(LHHash *state, void *buffer_)
+{
+  unsigned char *buffer = (unsigned char*)buffer_;
+  if(buffer) {
+    buffer[0] = 'L';
+    buffer[1] = 'H';
+    buffer[2] = LHHASH_EXPORT_VERSION;
+    buffer[3] = (unsigned char)state->vtable->type;
+  }
+  return 4 + state->vtable->export(state, (buffer ? buffer+4 : NULL));
+}
+
+LHHash* LHHash_import(const void *buffer_, size_t length)
+{
+  const unsigned char *buffer = (const unsigned char*)buffer_;
+  LHHash *state = NULL;
+
+  if(length < 4 || buffer[0] != 'L' || buffer[1] != 'H' || buffer[2] != LHHASH_EXPORT_VERSION)
+    return NULL;
+
+  switch(buffer[3]) {
+    case LHHASH_XXH64:
+      state = LHXXH64_new();
+      break;
+    case LHHASH_FNV64:
+      state = LHFNV64_new();
+      break;
+    default:
+      return NULL;
+  }
+
+  if(state && !state->vtable->import(state, buffer+4, length-4)) {
+    LHHash_free(state);
+    state = NULL;
+  }
+  return state;
+}
@@ -1,13 +1,25 @@
 /* private stuff */
 
+enum {
+  LHHASH_XXH64 = 1,
+  LHHASH_FNV64 = 2
+};
+
 struct LHHashVTable {
   void (*reset)(LHHash *state, unsigned long long seed);
   void (*update)(LHHash *state, const void* input, size_t length);
   unsigned long long (*digest) (LHHash* state);
   LHHash* (*clone)(LHHash *state);
   void (*free)(LHHash* state);
+  size_t (*export)(LHHash *state, unsigned char *buffer);
+  int (*import)(LHHash *state, const unsigned char *buffer, size_t length);
+  int type;
 };
 
 struct LHHash_ {
   struct LHHashVTable *vtable;
 };
+
+/* little-endian helpers for (de)serialization */
+void LHHash_writeU64(unsigned char *buffer, unsigned long long value);
+unsigned long long LHHash_readU64(const unsigned char *buffer);
@@ -8,10 +8,20 @@ typedef struct LHHash_ LHHash;
 LHHash* LHXXH64_new(void);
 LHHash* LHFNV64_new(void);
 
+/* one-shot XXH64, without state allocation */
+unsigned long long LHXXH64(const void* input, size_t length, unsigned long long seed);
+
 void LHHash_reset(LHHash *state, unsigned long long seed);
 void LHHash_update(LHHash *state, const void* input, size_t length);
 unsigned long long LHHash_digest(LHHash* state);
 LHHash* LHHash_clone(LHHash *state);
 void LHHash_free(LHHash* state);
 
+/* serialization: export returns the number of bytes needed (buffer may be NULL),
+   import returns NULL on invalid data */
+#define LHHASH_EXPORT_VERSION 1
+#define LHHASH_EXPORT_MAXSIZE 128
+size_t LHHash_export(LHHash *state, void *buffer);
+LHHash* LHHash_import(const void *buffer, size_t length);
+
 #endif
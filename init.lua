@@ -1,2 +1,44 @@
-return require 'libhash'
+local hash = require 'libhash'
 
+-- serialization (torch.save/torch.load) relies on export()/import()
+local function serializable(typename)
+   local mt = torch.getmetatable(typename)
+
+   function mt:write(file)
+      local data = self:export()
+      file:writeLong(#data)
+      file:writeChar(torch.CharStorage():string(data))
+   end
+
+   function mt:read(file)
+      local size = file:readLong()
+      self:import(file:readChar(size):string())
+   end
+end
+
+serializable('torch.Hash')
+serializable('torch.PerfectHash')
+
+-- LuaJIT FFI pointers go straight to the C library (no intermediate object)
+local ok, ffi = pcall(require, 'ffi')
+local libpath = ok and package.searchpath and package.searchpath('libhash', package.cpath)
+if libpath then
+   ffi.cdef[[
+void libhash_updateptr(void *udata, const void *ptr, size_t nbytes);
+]]
+   local C = ffi.load(libpath)
+   local Hash = torch.getmetatable('torch.Hash')
+   local updatePtr = Hash.updatePtr
+
+   function Hash:updatePtr(ptr, nbytes)
+      if type(ptr) == 'cdata' then
+         assert(getmetatable(self) == Hash, 'torch.Hash expected')
+         assert(nbytes >= 0, 'number of bytes should be non-negative')
+         C.libhash_updateptr(self, ptr, nbytes)
+         return self
+      end
+      return updatePtr(self, ptr, nbytes)
+   end
+end
+
+return hash
@@ -1,9 +1,16 @@
+#include <stdlib.h>
+#include <limits.h>
+
 #include <lua.h>
 #include <lauxlib.h>
 
 #include "luaT.h"
 #include "TH.h"
 #include "hash.h"
+#include "perfecthash.h"
+#include "unique.h"
+#include "async.h"
+#include "partition.h"
 
 #define LH_MAX_MOD 9007199254740992L
 
@@ -22,7 +29,73 @@ IMPLEMENT_THTENSOR_HASH(Long, long);
 IMPLEMENT_THTENSOR_HASH(Float, float);
 IMPLEMENT_THTENSOR_HASH(Double, double);
 
-static void libhash_updatehash(lua_State *L, LHHash *state, int idx)
+/* hashes the storage in-place, optionally (offset, length) given at rangeidx, in elements */
+#define IMPLEMENT_THSTORAGE_HASH(TYPE, CTYPE)                           \
+  static void TH##TYPE##Storage_hashUpdate(lua_State *L, TH##TYPE##Storage *storage, LHHash *hash, int rangeidx) \
+  {                                                                     \
+    long size = (long)TH##TYPE##Storage_size(storage);                  \
+    long offset = 1;                                                    \
+    long length = size;                                                 \
+    if(rangeidx) {                                                      \
+      offset = luaL_optlong(L, rangeidx, 1);                            \
+      luaL_argcheck(L, offset >= 1 && offset <= size+1, rangeidx, "offset out of range"); \
+      length = luaL_optlong(L, rangeidx+1, size-offset+1);              \
+      luaL_argcheck(L, length >= 0 && length <= size-offset+1, rangeidx+1, "length out of range"); \
+    }                                                                   \
+    if(length > 0)                                                      \
+      LHHash_update(hash, TH##TYPE##Storage_data(storage)+(offset-1), length*sizeof(CTYPE)); \
+  }
+
+IMPLEMENT_THSTORAGE_HASH(Byte, unsigned char);
+IMPLEMENT_THSTORAGE_HASH(Char, char);
+IMPLEMENT_THSTORAGE_HASH(Short, short);
+IMPLEMENT_THSTORAGE_HASH(Int, int);
+IMPLEMENT_THSTORAGE_HASH(Long, long);
+IMPLEMENT_THSTORAGE_HASH(Float, float);
+IMPLEMENT_THSTORAGE_HASH(Double, double);
+
+#define IMPLEMENT_THTENSOR_HASHASYNC(TYPE)                              \
+  static void TH##TYPE##Tensor_hashUpdateAsync(LHHash *hash, void *tensor) \
+  {                                                                     \
+    TH##TYPE##Tensor_hashUpdate((TH##TYPE##Tensor*)tensor, hash);       \
+  }                                                                     \
+                                                                        \
+  static void TH##TYPE##Tensor_releaseAsync(void *tensor)               \
+  {                                                                     \
+    TH##TYPE##Tensor_free((TH##TYPE##Tensor*)tensor);                   \
+  }
+
+IMPLEMENT_THTENSOR_HASHASYNC(Byte);
+IMPLEMENT_THTENSOR_HASHASYNC(Char);
+IMPLEMENT_THTENSOR_HASHASYNC(Short);
+IMPLEMENT_THTENSOR_HASHASYNC(Int);
+IMPLEMENT_THTENSOR_HASHASYNC(Long);
+IMPLEMENT_THTENSOR_HASHASYNC(Float);
+IMPLEMENT_THTENSOR_HASHASYNC(Double);
+
+/* copy of a Lua string or number, for asynchronous hashing */
+typedef struct {
+  size_t length;
+  char data[];
+} libhash_Buffer;
+
+static void libhash_Buffer_hashUpdateAsync(LHHash *hash, void *buffer)
+{
+  LHHash_update(hash, ((libhash_Buffer*)buffer)->data, ((libhash_Buffer*)buffer)->length);
+}
+
+static void libhash_Buffer_releaseAsync(void *buffer)
+{
+  free(buffer);
+}
+
+typedef struct {
+  LHAsyncJob *job;
+  LHHash *state; /* owned state (hash.hashAsync), or NULL */
+} libhash_HashFuture;
+
+/* storages accept an optional (offset, length) at rangeidx (if non-zero) */
+static void libhash_updatehash(lua_State *L, LHHash *state, int idx, int rangeidx)
 {
   if(lua_type(L, idx) == LUA_TSTRING) {
     size_t len = 0;
@@ -54,8 +127,29 @@ static void libhash_updatehash(lua_State *L, LHHash *state, int idx)
   else if(luaT_isudata(L, idx, "torch.DoubleTensor")) {
     THDoubleTensor_hashUpdate(luaT_toudata(L, idx, "torch.DoubleTensor"), state);
   }
+  else if(luaT_isudata(L, idx, "torch.ByteStorage")) {
+    THByteStorage_hashUpdate(L, luaT_toudata(L, idx, "torch.ByteStorage"), state, rangeidx);
+  }
+  else if(luaT_isudata(L, idx, "torch.CharStorage")) {
+    THCharStorage_hashUpdate(L, luaT_toudata(L, idx, "torch.CharStorage"), state, rangeidx);
+  }
+  else if(luaT_isudata(L, idx, "torch.ShortStorage")) {
+    THShortStorage_hashUpdate(L, luaT_toudata(L, idx, "torch.ShortStorage"), state, rangeidx);
+  }
+  else if(luaT_isudata(L, idx, "torch.IntStorage")) {
+    THIntStorage_hashUpdate(L, luaT_toudata(L, idx, "torch.IntStorage"), state, rangeidx);
+  }
+  else if(luaT_isudata(L, idx, "torch.LongStorage")) {
+    THLongStorage_hashUpdate(L, luaT_toudata(L, idx, "torch.LongStorage"), state, rangeidx);
+  }
+  else if(luaT_isudata(L, idx, "torch.FloatStorage")) {
+    THFloatStorage_hashUpdate(L, luaT_toudata(L, idx, "torch.FloatStorage"), state, rangeidx);
+  }
+  else if(luaT_isudata(L, idx, "torch.DoubleStorage")) {
+    THDoubleStorage_hashUpdate(L, luaT_toudata(L, idx, "torch.DoubleStorage"), state, rangeidx);
+  }
   else {
-    luaL_error(L, "string, number, or tensor [number] expected");
+    luaL_error(L, "string, number, tensor or storage [number] expected");
   }
 }
 
@@ -91,6 +185,7 @@ static int libhash_hash(lua_State *L)
     freestate = 1;
   } else if((nopt >= 2 && nopt <= 4) && luaT_toudata(L, 2, "torch.Hash")) {
     state = luaT_toudata(L, 2, "torch.Hash");
+    LHAsync_sync(state);
     seed = (unsigned long long)luaL_optlong(L, 3, 0);
     mod = (unsigned long long)luaL_optlong(L, 4, LH_MAX_MOD);
   } else {
@@ -100,7 +195,7 @@ static int libhash_hash(lua_State *L)
   if(!state)
     luaL_error(L, "invalid Hash state");
   LHHash_reset(state, seed);
-  libhash_updatehash(L, state, 1);
+  libhash_updatehash(L, state, 1, 0);
   res = LHHash_digest(state);
   res = res % mod;
   if(freestate)
@@ -110,6 +205,418 @@ static int libhash_hash(lua_State *L)
   return 1;
 }
 
+/* pushes unique values (or rows), first occurrence indices, inverse indices and counts */
+#define IMPLEMENT_THTENSOR_UNIQUE(TYPE, CTYPE)                          \
+  static void TH##TYPE##Tensor_unique(lua_State *L, TH##TYPE##Tensor *tensor, int dim, int nthreads) \
+  {                                                                     \
+    TH##TYPE##Tensor *rows = NULL;                                      \
+    TH##TYPE##Tensor *values = NULL;                                    \
+    THLongTensor *first = NULL;                                         \
+    THLongTensor *inverse = NULL;                                       \
+    THLongTensor *counts = NULL;                                        \
+    long *first_buffer = NULL;                                          \
+    long *counts_buffer = NULL;                                         \
+    long *first_data = NULL;                                            \
+    long *counts_data = NULL;                                           \
+    long *inverse_data = NULL;                                          \
+    size_t rowsize = sizeof(CTYPE);                                     \
+    long n, k, i;                                                       \
+                                                                        \
+    luaL_argcheck(L, dim < TH##TYPE##Tensor_nDimension(tensor), 2, "out of range dimension"); \
+    if(dim < 0) {                                                       \
+      rows = TH##TYPE##Tensor_newContiguous(tensor);                    \
+      n = TH##TYPE##Tensor_nElement(rows);                              \
+    } else {                                                            \
+      TH##TYPE##Tensor *transposed = TH##TYPE##Tensor_newTranspose(tensor, 0, dim); \
+      rows = TH##TYPE##Tensor_newContiguous(transposed);                \
+      TH##TYPE##Tensor_free(transposed);                                \
+      n = TH##TYPE##Tensor_size(rows, 0);                               \
+      rowsize *= (n > 0 ? TH##TYPE##Tensor_nElement(rows)/n : 0);       \
+    }                                                                   \
+                                                                        \
+    /* first and counts have k entries, computed in scratch buffers */  \
+    first_buffer = malloc(sizeof(long)*(n+1));                          \
+    counts_buffer = malloc(sizeof(long)*(n+1));                         \
+    inverse = THLongTensor_newWithSize1d(n);                            \
+    k = -1;                                                             \
+    if(first_buffer && counts_buffer)                                   \
+      k = LHUnique(TH##TYPE##Tensor_data(rows), n, rowsize,             \
+                   first_buffer, THLongTensor_data(inverse),            \
+                   counts_buffer, nthreads);                            \
+    if(k < 0) {                                                         \
+      TH##TYPE##Tensor_free(rows);                                      \
+      THLongTensor_free(inverse);                                       \
+      free(first_buffer);                                               \
+      free(counts_buffer);                                              \
+      luaL_error(L, "out of memory");                                   \
+    }                                                                   \
+                                                                        \
+    /* 1-based indices */                                               \
+    first = THLongTensor_newWithSize1d(k);                              \
+    counts = THLongTensor_newWithSize1d(k);                             \
+    first_data = THLongTensor_data(first);                              \
+    counts_data = THLongTensor_data(counts);                            \
+    inverse_data = THLongTensor_data(inverse);                          \
+    for(i = 0; i < k; i++) {                                            \
+      first_data[i] = first_buffer[i]+1;                                \
+      counts_data[i] = counts_buffer[i];                                \
+    }                                                                   \
+    for(i = 0; i < n; i++)                                              \
+      inverse_data[i]++;                                                \
+    free(first_buffer);                                                 \
+    free(counts_buffer);                                                \
+                                                                        \
+    if(dim < 0) {                                                       \
+      CTYPE *rows_data = TH##TYPE##Tensor_data(rows);                   \
+      CTYPE *values_data = NULL;                                        \
+      values = TH##TYPE##Tensor_newWithSize1d(k);                       \
+      values_data = TH##TYPE##Tensor_data(values);                      \
+      for(i = 0; i < k; i++)                                            \
+        values_data[i] = rows_data[first_data[i]-1];                    \
+    } else if(k > 0) {                                                  \
+      values = TH##TYPE##Tensor_new();                                  \
+      TH##TYPE##Tensor_indexSelect(values, tensor, dim, first);         \
+    } else                                                              \
+      values = TH##TYPE##Tensor_newClone(tensor);                       \
+    TH##TYPE##Tensor_free(rows);                                        \
+                                                                        \
+    luaT_pushudata(L, values, "torch." #TYPE "Tensor");                 \
+    luaT_pushudata(L, first, "torch.LongTensor");                       \
+    luaT_pushudata(L, inverse, "torch.LongTensor");                     \
+    luaT_pushudata(L, counts, "torch.LongTensor");                      \
+  }
+
+IMPLEMENT_THTENSOR_UNIQUE(Byte, unsigned char);
+IMPLEMENT_THTENSOR_UNIQUE(Char, char);
+IMPLEMENT_THTENSOR_UNIQUE(Short, short);
+IMPLEMENT_THTENSOR_UNIQUE(Int, int);
+IMPLEMENT_THTENSOR_UNIQUE(Long, long);
+IMPLEMENT_THTENSOR_UNIQUE(Float, float);
+IMPLEMENT_THTENSOR_UNIQUE(Double, double);
+
+/*
+  tensor [dim] [nthreads]
+*/
+static int libhash_unique(lua_State *L)
+{
+  int dim = -1; /* flat */
+  int nthreads = (int)luaL_optlong(L, 3, 1);
+
+  if(!lua_isnoneornil(L, 2)) {
+    dim = (int)luaL_checklong(L, 2) - 1;
+    luaL_argcheck(L, dim >= 0, 2, "out of range dimension");
+  }
+
+  if(luaT_isudata(L, 1, "torch.ByteTensor"))
+    THByteTensor_unique(L, luaT_toudata(L, 1, "torch.ByteTensor"), dim, nthreads);
+  else if(luaT_isudata(L, 1, "torch.CharTensor"))
+    THCharTensor_unique(L, luaT_toudata(L, 1, "torch.CharTensor"), dim, nthreads);
+  else if(luaT_isudata(L, 1, "torch.ShortTensor"))
+    THShortTensor_unique(L, luaT_toudata(L, 1, "torch.ShortTensor"), dim, nthreads);
+  else if(luaT_isudata(L, 1, "torch.IntTensor"))
+    THIntTensor_unique(L, luaT_toudata(L, 1, "torch.IntTensor"), dim, nthreads);
+  else if(luaT_isudata(L, 1, "torch.LongTensor"))
+    THLongTensor_unique(L, luaT_toudata(L, 1, "torch.LongTensor"), dim, nthreads);
+  else if(luaT_isudata(L, 1, "torch.FloatTensor"))
+    THFloatTensor_unique(L, luaT_toudata(L, 1, "torch.FloatTensor"), dim, nthreads);
+  else if(luaT_isudata(L, 1, "torch.DoubleTensor"))
+    THDoubleTensor_unique(L, luaT_toudata(L, 1, "torch.DoubleTensor"), dim, nthreads);
+  else
+    luaL_error(L, "tensor [dim] [nthreads] expected");
+
+  return 4;
+}
+
+/* byte offsets of the (1-based) key columns (of colsize bytes each) found in a table or a LongTensor */
+static size_t* libhash_partitionkeys(lua_State *L, int idx, long ncols, size_t colsize, long *nkeys)
+{
+  size_t *keyoffsets = NULL;
+  long n = 0, i;
+
+  if(lua_isnoneornil(L, idx)) {
+    *nkeys = 0;
+    return NULL;
+  }
+
+  if(lua_istable(L, idx)) {
+    n = (long)lua_objlen(L, idx);
+    keyoffsets = malloc(sizeof(size_t)*(n+1));
+    if(!keyoffsets)
+      luaL_error(L, "out of memory");
+    for(i = 0; i < n; i++) {
+      lua_Number number;
+      long col;
+      lua_rawgeti(L, idx, i+1);
+      number = lua_tonumber(L, -1);
+      col = (long)number;
+      if(!lua_isnumber(L, -1) || (lua_Number)col != number) {
+        free(keyoffsets);
+        luaL_argerror(L, idx, "key columns must be integers");
+      }
+      lua_pop(L, 1);
+      if(col < 1 || col > ncols) {
+        free(keyoffsets);
+        luaL_error(L, "key column out of range");
+      }
+      keyoffsets[i] = (col-1)*colsize;
+    }
+  }
+  else if(luaT_isudata(L, idx, "torch.LongTensor")) {
+    THLongTensor *cols = THLongTensor_newContiguous(luaT_toudata(L, idx, "torch.LongTensor"));
+    long *cols_data = THLongTensor_data(cols);
+    n = THLongTensor_nElement(cols);
+    keyoffsets = malloc(sizeof(size_t)*(n+1));
+    for(i = 0; keyoffsets && i < n; i++) {
+      if(cols_data[i] < 1 || cols_data[i] > ncols) {
+        free(keyoffsets);
+        THLongTensor_free(cols);
+        luaL_error(L, "key column out of range");
+      }
+      keyoffsets[i] = (cols_data[i]-1)*colsize;
+    }
+    THLongTensor_free(cols);
+    if(!keyoffsets)
+      luaL_error(L, "out of memory");
+  }
+  else
+    luaL_error(L, "key columns must be a table or a LongTensor");
+
+  *nkeys = n;
+  return keyoffsets;
+}
+
+/* pushes the permutation and the partition offsets */
+#define IMPLEMENT_THTENSOR_PARTITION(TYPE, CTYPE)                       \
+  static void TH##TYPE##Tensor_partition(lua_State *L, TH##TYPE##Tensor *tensor, long nparts, \
+                                         unsigned long long seed, int nthreads) \
+  {                                                                     \
+    TH##TYPE##Tensor *rows = NULL;                                      \
+    THLongTensor *perm = NULL;                                          \
+    THLongTensor *offsets = NULL;                                       \
+    size_t *keyoffsets = NULL;                                          \
+    long *perm_data = NULL;                                             \
+    long *offsets_data = NULL;                                          \
+    lua_Number *numbers = NULL;                                         \
+    const void *data = NULL;                                            \
+    size_t elemsize = sizeof(CTYPE);                                    \
+    long n, ncols, colsize, nkeys, i;                                   \
+    int ok = 0;                                                         \
+                                                                        \
+    luaL_argcheck(L, TH##TYPE##Tensor_nDimension(tensor) > 0, 1, "non-empty tensor expected"); \
+    n = TH##TYPE##Tensor_size(tensor, 0);                               \
+    /* columns are the slices along the second dimension */            \
+    ncols = (TH##TYPE##Tensor_nDimension(tensor) > 1 ? TH##TYPE##Tensor_size(tensor, 1) : 1); \
+    colsize = (n > 0 && ncols > 0 ? TH##TYPE##Tensor_nElement(tensor)/(n*ncols) : 0); \
+    /* elements of a 1D tensor are hashed as Lua numbers, as in hash.hash(tensor[i]) */ \
+    if(TH##TYPE##Tensor_nDimension(tensor) == 1)                        \
+      elemsize = sizeof(lua_Number);                                    \
+    keyoffsets = libhash_partitionkeys(L, 3, ncols, colsize*elemsize, &nkeys); \
+                                                                        \
+    rows = TH##TYPE##Tensor_newContiguous(tensor);                      \
+    data = TH##TYPE##Tensor_data(rows);                                 \
+    if(TH##TYPE##Tensor_nDimension(tensor) == 1) {                      \
+      CTYPE *rows_data = TH##TYPE##Tensor_data(rows);                   \
+      numbers = malloc(sizeof(lua_Number)*(n+1));                       \
+      for(i = 0; numbers && i < n; i++)                                 \
+        numbers[i] = (lua_Number)rows_data[i];                          \
+      data = numbers;                                                   \
+    }                                                                   \
+    perm = THLongTensor_newWithSize1d(n);                               \
+    offsets = THLongTensor_newWithSize1d(nparts+1);                     \
+    perm_data = THLongTensor_data(perm);                                \
+    offsets_data = THLongTensor_data(offsets);                          \
+    if(data)                                                            \
+      ok = LHPartition(data, n, ncols*colsize*elemsize,                 \
+                       keyoffsets, nkeys, colsize*elemsize,             \
+                       seed, LH_MAX_MOD, nparts, nthreads,              \
+                       perm_data, offsets_data);                        \
+    free(numbers);                                                      \
+    TH##TYPE##Tensor_free(rows);                                        \
+    free(keyoffsets);                                                   \
+    if(!ok) {                                                           \
+      THLongTensor_free(perm);                                          \
+      THLongTensor_free(offsets);                                       \
+      luaL_error(L, "out of memory");                                   \
+    }                                                                   \
+                                                                        \
+    /* 1-based indices */                                               \
+    for(i = 0; i < n; i++)                                              \
+      perm_data[i]++;                                                   \
+    for(i = 0; i <= nparts; i++)                                        \
+      offsets_data[i]++;                                                \
+                                                                        \
+    luaT_pushudata(L, perm, "torch.LongTensor");                        \
+    luaT_pushudata(L, offsets, "torch.LongTensor");                     \
+  }
+
+IMPLEMENT_THTENSOR_PARTITION(Byte, unsigned char);
+IMPLEMENT_THTENSOR_PARTITION(Char, char);
+IMPLEMENT_THTENSOR_PARTITION(Short, short);
+IMPLEMENT_THTENSOR_PARTITION(Int, int);
+IMPLEMENT_THTENSOR_PARTITION(Long, long);
+IMPLEMENT_THTENSOR_PARTITION(Float, float);
+IMPLEMENT_THTENSOR_PARTITION(Double, double);
+
+/*
+  tensor nparts [keyColumns] [seed] [nthreads]
+*/
+static int libhash_partition(lua_State *L)
+{
+  long nparts = luaL_checklong(L, 2);
+  unsigned long long seed = (unsigned long long)luaL_optlong(L, 4, 0);
+  int nthreads = (int)luaL_optlong(L, 5, 1);
+
+  luaL_argcheck(L, nparts > 0 && nparts <= 0xffffffffL, 2, "invalid number of partitions");
+
+  if(luaT_isudata(L, 1, "torch.ByteTensor"))
+    THByteTensor_partition(L, luaT_toudata(L, 1, "torch.ByteTensor"), nparts, seed, nthreads);
+  else if(luaT_isudata(L, 1, "torch.CharTensor"))
+    THCharTensor_partition(L, luaT_toudata(L, 1, "torch.CharTensor"), nparts, seed, nthreads);
+  else if(luaT_isudata(L, 1, "torch.ShortTensor"))
+    THShortTensor_partition(L, luaT_toudata(L, 1, "torch.ShortTensor"), nparts, seed, nthreads);
+  else if(luaT_isudata(L, 1, "torch.IntTensor"))
+    THIntTensor_partition(L, luaT_toudata(L, 1, "torch.IntTensor"), nparts, seed, nthreads);
+  else if(luaT_isudata(L, 1, "torch.LongTensor"))
+    THLongTensor_partition(L, luaT_toudata(L, 1, "torch.LongTensor"), nparts, seed, nthreads);
+  else if(luaT_isudata(L, 1, "torch.FloatTensor"))
+    THFloatTensor_partition(L, luaT_toudata(L, 1, "torch.FloatTensor"), nparts, seed, nthreads);
+  else if(luaT_isudata(L, 1, "torch.DoubleTensor"))
+    THDoubleTensor_partition(L, luaT_toudata(L, 1, "torch.DoubleTensor"), nparts, seed, nthreads);
+  else
+    luaL_error(L, "tensor nparts [keyColumns] [seed] [nthreads] expected");
+
+  return 2;
+}
+
+/* waits for pending asynchronous updates */
+static LHHash* libhash_checkstate(lua_State *L, int idx)
+{
+  LHHash *state = luaT_checkudata(L, idx, "torch.Hash");
+  LHAsync_sync(state);
+  return state;
+}
+
+/* the future takes ownership of state if ownstate is true */
+static void libhash_pushfuture(lua_State *L, LHHash *state, int ownstate, int idx)
+{
+  libhash_HashFuture *future = NULL;
+  LHAsyncWork work = NULL;
+  LHAsyncRelease release = NULL;
+  void *data = NULL;
+
+  if(lua_type(L, idx) == LUA_TSTRING || lua_type(L, idx) == LUA_TNUMBER) {
+    libhash_Buffer *buffer = NULL;
+    lua_Number num = 0;
+    size_t len = sizeof(lua_Number);
+    const char *str = (const char*)&num;
+    if(lua_type(L, idx) == LUA_TSTRING)
+      str = lua_tolstring(L, idx, &len);
+    else
+      num = lua_tonumber(L, idx);
+    buffer = malloc(sizeof(libhash_Buffer) + len);
+    if(buffer) {
+      buffer->length = len;
+      memcpy(buffer->data, str, len);
+    }
+    data = buffer;
+    work = libhash_Buffer_hashUpdateAsync;
+    release = libhash_Buffer_releaseAsync;
+  }
+#define LIBHASH_ASYNC_TENSOR(TYPE)                                      \
+  else if(luaT_isudata(L, idx, "torch." #TYPE "Tensor")) {              \
+    data = luaT_toudata(L, idx, "torch." #TYPE "Tensor");               \
+    TH##TYPE##Tensor_retain((TH##TYPE##Tensor*)data);                   \
+    work = TH##TYPE##Tensor_hashUpdateAsync;                            \
+    release = TH##TYPE##Tensor_releaseAsync;                            \
+  }
+  LIBHASH_ASYNC_TENSOR(Byte)
+  LIBHASH_ASYNC_TENSOR(Char)
+  LIBHASH_ASYNC_TENSOR(Short)
+  LIBHASH_ASYNC_TENSOR(Int)
+  LIBHASH_ASYNC_TENSOR(Long)
+  LIBHASH_ASYNC_TENSOR(Float)
+  LIBHASH_ASYNC_TENSOR(Double)
+#undef LIBHASH_ASYNC_TENSOR
+  else {
+    if(ownstate)
+      LHHash_free(state);
+    luaL_error(L, "string, number, or tensor expected");
+  }
+
+  future = malloc(sizeof(libhash_HashFuture));
+  if(data && future) {
+    future->state = (ownstate ? state : NULL);
+    future->job = LHAsync_update(state, work, release, data);
+  }
+  if(!data || !future || !future->job) {
+    if(data)
+      release(data);
+    free(future);
+    if(ownstate)
+      LHHash_free(state);
+    luaL_error(L, "could not start asynchronous hashing");
+  }
+
+  luaT_pushudata(L, future, "torch.HashFuture");
+}
+
+/*
+  stuff [seed]
+*/
+static int libhash_hashAsync(lua_State *L)
+{
+  unsigned long long seed = (unsigned long long)luaL_optlong(L, 2, 0);
+  LHHash *state = LHXXH64_new();
+  if(!state)
+    luaL_error(L, "out of memory");
+  LHHash_reset(state, seed);
+  libhash_pushfuture(L, state, 1, 1);
+  return 1;
+}
+
+static int libhash_LHHash_updateAsync(lua_State *L)
+{
+  LHHash *state = luaT_checkudata(L, 1, "torch.Hash");
+  libhash_pushfuture(L, state, 0, 2);
+  return 1;
+}
+
+static int libhash_HashFuture_wait(lua_State *L)
+{
+  libhash_HashFuture *future = luaT_checkudata(L, 1, "torch.HashFuture");
+  LHAsync_wait(future->job);
+  lua_pushvalue(L, 1);
+  return 1; /* self */
+}
+
+static int libhash_HashFuture_ready(lua_State *L)
+{
+  libhash_HashFuture *future = luaT_checkudata(L, 1, "torch.HashFuture");
+  lua_pushboolean(L, LHAsync_ready(future->job));
+  return 1;
+}
+
+static int libhash_HashFuture_digest(lua_State *L)
+{
+  libhash_HashFuture *future = luaT_checkudata(L, 1, "torch.HashFuture");
+  unsigned long long mod = (unsigned long long)luaL_optlong(L, 2, LH_MAX_MOD);
+  unsigned long long res = 0;
+  luaL_argcheck(L, mod > 0, 2, "modulo should be positive");
+  res = LHAsync_digest(future->job) % mod;
+  lua_pushinteger(L, (long)res);
+  return 1;
+}
+
+static int libhash_HashFuture_free(lua_State *L)
+{
+  libhash_HashFuture *future = luaT_checkudata(L, 1, "torch.HashFuture");
+  LHAsync_free(future->job);
+  if(future->state)
+    LHHash_free(future->state);
+  free(future);
+  return 0;
+}
+
 static int libhash_LHXXH64_new(lua_State *L)
 {
   LHHash *state = LHXXH64_new();
@@ -130,28 +637,68 @@ static int libhash_LHFNV64_new(lua_State *L)
 
 static int libhash_LHHash_reset(lua_State *L)
 {
-  LHHash *state = luaT_checkudata(L, 1, "torch.Hash");
+  LHHash *state = libhash_checkstate(L, 1);
   unsigned long long seed = (unsigned long long)luaL_optlong(L, 2, 0);
   LHHash_reset(state, seed);
+  lua_pushvalue(L, 1);
   return 1; /* self */
 }
 
+/*
+  stuff
+  storage [offset] [length]
+*/
 static int libhash_LHHash_update(lua_State *L)
 {
-  LHHash *state = luaT_checkudata(L, 1, "torch.Hash");
-  libhash_updatehash(L, state, 2);
+  LHHash *state = libhash_checkstate(L, 1);
+  libhash_updatehash(L, state, 2, 3);
+  lua_pushvalue(L, 1);
   return 1; /* self */
 }
 
+/*
+  address nbytes
+  (address being a light userdata or a number, see libhash_updateptr() for FFI pointers)
+*/
+static int libhash_LHHash_updatePtr(lua_State *L)
+{
+  LHHash *state = libhash_checkstate(L, 1);
+  long nbytes = luaL_checklong(L, 3);
+  const void *ptr = NULL;
+  if(lua_type(L, 2) == LUA_TLIGHTUSERDATA)
+    ptr = lua_touserdata(L, 2);
+  else if(lua_type(L, 2) == LUA_TNUMBER)
+    ptr = (const void*)(size_t)lua_tonumber(L, 2);
+  else
+    luaL_argerror(L, 2, "pointer expected");
+  luaL_argcheck(L, nbytes >= 0, 3, "number of bytes should be non-negative");
+  luaL_argcheck(L, ptr || nbytes == 0, 2, "NULL pointer");
+  LHHash_update(state, ptr, nbytes);
+  lua_pushvalue(L, 1);
+  return 1; /* self */
+}
+
+/*
+  entry point for LuaJIT FFI (see init.lua), such that FFI pointers are
+  hashed without creating any intermediate object: FFI passes a userdata
+  given as void* as the address of its payload, i.e. the LHHash* it holds
+*/
+void libhash_updateptr(void *udata, const void *ptr, size_t nbytes)
+{
+  LHHash *state = *(LHHash**)udata;
+  LHAsync_sync(state);
+  LHHash_update(state, ptr, nbytes);
+}
+
 static int libhash_LHHash_hash(lua_State *L)
 {
-  LHHash *state = luaT_checkudata(L, 1, "torch.Hash");
+  LHHash *state = libhash_checkstate(L, 1);
   unsigned long long seed = (unsigned long long)luaL_optlong(L, 3, 0);
   unsigned long long mod = (unsigned long long)luaL_optlong(L, 4, LH_MAX_MOD);
   unsigned long long res = 0;
   luaL_argcheck(L, mod > 0, 4, "modulo should be positive");
   LHHash_reset(state, seed);
-  libhash_updatehash(L, state, 2);
+  libhash_updatehash(L, state, 2, 0);
   res = LHHash_digest(state);
   res %= mod;
   lua_pushnumber(L, res);
@@ -160,7 +707,7 @@ static int libhash_LHHash_hash(lua_State *L)
 
 static int libhash_LHHash_digest(lua_State *L)
 {
-  LHHash *state = luaT_checkudata(L, 1, "torch.Hash");
+  LHHash *state = libhash_checkstate(L, 1);
   unsigned long long mod = (unsigned long long)luaL_optlong(L, 2, LH_MAX_MOD);
   luaL_argcheck(L, mod > 0, 2, "modulo should be positive");
   unsigned long long res = LHHash_digest(state) % mod;
@@ -170,25 +717,304 @@ static int libhash_LHHash_digest(lua_State *L)
 
 static int libhash_LHHash_clone(lua_State *L)
 {
-  LHHash *state = luaT_checkudata(L, 1, "torch.Hash");
+  LHHash *state = libhash_checkstate(L, 1);
   LHHash *newstate = LHHash_clone(state);
   luaT_pushudata(L, newstate, "torch.Hash");
   return 1;
 }
 
+static int libhash_LHHash_export(lua_State *L)
+{
+  LHHash *state = libhash_checkstate(L, 1);
+  unsigned char buffer[LHHASH_EXPORT_MAXSIZE];
+  size_t len = LHHash_export(state, buffer);
+  lua_pushlstring(L, (const char*)buffer, len);
+  return 1;
+}
+
+/* replaces in-place the state held by the userdata (used by torch.load) */
+static int libhash_LHHash_import(lua_State *L)
+{
+  LHHash **udata = NULL;
+  LHHash *newstate = NULL;
+  size_t len = 0;
+  const char *str = NULL;
+  libhash_checkstate(L, 1);
+  str = luaL_checklstring(L, 2, &len);
+  newstate = LHHash_import(str, len);
+  if(!newstate)
+    luaL_error(L, "invalid or unsupported exported Hash state");
+  udata = (LHHash**)lua_touserdata(L, 1);
+  LHHash_free(*udata);
+  *udata = newstate;
+  lua_pushvalue(L, 1);
+  return 1; /* self */
+}
+
+static int libhash_import(lua_State *L)
+{
+  size_t len = 0;
+  const char *str = luaL_checklstring(L, 1, &len);
+  LHHash *state = LHHash_import(str, len);
+  if(!state)
+    luaL_error(L, "invalid or unsupported exported Hash state");
+  luaT_pushudata(L, state, "torch.Hash");
+  return 1;
+}
+
+/* used by torch.factory(), the state is then filled by read() */
+static int libhash_LHHash_factory(lua_State *L)
+{
+  LHHash *state = LHXXH64_new();
+  LHHash_reset(state, 0);
+  luaT_pushudata(L, state, "torch.Hash");
+  return 1;
+}
+
 static int libhash_LHHash_free(lua_State *L)
 {
-  LHHash *state = luaT_checkudata(L, 1, "torch.Hash");
+  LHHash *state = libhash_checkstate(L, 1);
   LHHash_free(state);
   return 0;
 }
 
+/* fingerprint of a string or of an integer (hashed as a long, as LongTensor keys); returns 0 for other values */
+static int libhash_perfecthash_key(lua_State *L, int idx, unsigned long long *key)
+{
+  if(lua_type(L, idx) == LUA_TSTRING) {
+    size_t len = 0;
+    const char *str = lua_tolstring(L, idx, &len);
+    *key = LHPerfectHash_key(str, len);
+    return 1;
+  }
+  else if(lua_type(L, idx) == LUA_TNUMBER) {
+    lua_Number num = lua_tonumber(L, idx);
+    long lnum;
+    if(!(num >= (lua_Number)LONG_MIN && num < -(lua_Number)LONG_MIN))
+      return 0;
+    lnum = (long)num;
+    if((lua_Number)lnum != num)
+      return 0;
+    *key = LHPerfectHash_key(&lnum, sizeof(long));
+    return 1;
+  }
+  return 0;
+}
+
+/* key fingerprints of a table of strings/integers or of a LongTensor */
+static unsigned long long* libhash_perfecthash_keys(lua_State *L, int idx, size_t *nkeys)
+{
+  unsigned long long *keys = NULL;
+  size_t n = 0, i;
+
+  if(lua_istable(L, idx)) {
+    n = lua_objlen(L, idx);
+    keys = malloc(sizeof(unsigned long long)*(n+1));
+    if(!keys)
+      luaL_error(L, "out of memory");
+    for(i = 0; i < n; i++) {
+      lua_rawgeti(L, idx, i+1);
+      if(!libhash_perfecthash_key(L, -1, &keys[i])) {
+        free(keys);
+        luaL_error(L, "keys must be strings or integers");
+      }
+      lua_pop(L, 1);
+    }
+  }
+  else if(luaT_isudata(L, idx, "torch.LongTensor")) {
+    THLongTensor *tensor = THLongTensor_newContiguous(luaT_toudata(L, idx, "torch.LongTensor"));
+    long *data = THLongTensor_data(tensor);
+    n = THLongTensor_nElement(tensor);
+    keys = malloc(sizeof(unsigned long long)*(n+1));
+    if(!keys) {
+      THLongTensor_free(tensor);
+      luaL_error(L, "out of memory");
+    }
+    for(i = 0; i < n; i++)
+      keys[i] = LHPerfectHash_key(&data[i], sizeof(long));
+    THLongTensor_free(tensor);
+  }
+  else
+    luaL_error(L, "table of strings or LongTensor expected");
+
+  *nkeys = n;
+  return keys;
+}
+
+/*
+  keys [gamma] [nthreads]
+*/
+static int libhash_LHPerfectHash_new(lua_State *L)
+{
+  /* arguments are checked before allocating keys */
+  double gamma = luaL_optnumber(L, 2, 2);
+  int nthreads = (int)luaL_optlong(L, 3, 0);
+  size_t nkeys = 0;
+  unsigned long long *keys = libhash_perfecthash_keys(L, 1, &nkeys);
+  LHPerfectHash *ph = LHPerfectHash_new(keys, nkeys, gamma, nthreads);
+  free(keys);
+  if(!ph)
+    luaL_error(L, "could not build perfect hash: identical key fingerprints (duplicate keys, or 64 bits hash collision) or out of memory");
+  luaT_pushudata(L, ph, "torch.PerfectHash");
+  return 1;
+}
+
+static int libhash_LHPerfectHash_load(lua_State *L)
+{
+  const char *filename = luaL_checkstring(L, 1);
+  LHPerfectHash *ph = LHPerfectHash_load(filename);
+  if(!ph)
+    luaL_error(L, "could not load perfect hash from <%s>", filename);
+  luaT_pushudata(L, ph, "torch.PerfectHash");
+  return 1;
+}
+
+/*
+  ids start at 1, 0 means the key is not present
+  key
+  keys [LongTensor]
+*/
+static int libhash_LHPerfectHash_lookup(lua_State *L)
+{
+  LHPerfectHash *ph = luaT_checkudata(L, 1, "torch.PerfectHash");
+
+  if(lua_type(L, 2) == LUA_TSTRING || lua_type(L, 2) == LUA_TNUMBER) {
+    unsigned long long key = 0;
+    luaL_argcheck(L, libhash_perfecthash_key(L, 2, &key), 2, "string or integer expected");
+    lua_pushnumber(L, LHPerfectHash_lookup(ph, key)+1);
+  }
+  else {
+    THLongTensor *ids = luaT_toudata(L, 3, "torch.LongTensor");
+    long *ids_data = NULL;
+    long n, i;
+
+    if(ids)
+      lua_pushvalue(L, 3);
+    else {
+      ids = THLongTensor_new();
+      luaT_pushudata(L, ids, "torch.LongTensor");
+    }
+
+    if(lua_istable(L, 2)) {
+      n = (long)lua_objlen(L, 2);
+      THLongTensor_resize1d(ids, n);
+      luaL_argcheck(L, THLongTensor_isContiguous(ids), 3, "contiguous LongTensor expected");
+      ids_data = THLongTensor_data(ids);
+      for(i = 0; i < n; i++) {
+        unsigned long long key = 0;
+        lua_rawgeti(L, 2, i+1);
+        if(!libhash_perfecthash_key(L, -1, &key))
+          luaL_error(L, "keys must be strings or integers");
+        lua_pop(L, 1);
+        ids_data[i] = LHPerfectHash_lookup(ph, key)+1;
+      }
+    }
+    else if(luaT_isudata(L, 2, "torch.LongTensor")) {
+      THLongTensor *keys = THLongTensor_newContiguous(luaT_toudata(L, 2, "torch.LongTensor"));
+      n = THLongTensor_nElement(keys);
+      THLongTensor_resize1d(ids, n);
+      if(!THLongTensor_isContiguous(ids)) {
+        THLongTensor_free(keys);
+        luaL_argerror(L, 3, "contiguous LongTensor expected");
+      }
+      ids_data = THLongTensor_data(ids);
+      LHPerfectHash_lookupBatch(ph, THLongTensor_data(keys), sizeof(long), n, ids_data, 0);
+      THLongTensor_free(keys);
+      for(i = 0; i < n; i++)
+        ids_data[i]++;
+    }
+    else
+      luaL_error(L, "string, number, table or LongTensor expected");
+  }
+
+  return 1;
+}
+
+static int libhash_LHPerfectHash_size(lua_State *L)
+{
+  LHPerfectHash *ph = luaT_checkudata(L, 1, "torch.PerfectHash");
+  lua_pushnumber(L, LHPerfectHash_size(ph));
+  return 1;
+}
+
+static int libhash_LHPerfectHash_save(lua_State *L)
+{
+  LHPerfectHash *ph = luaT_checkudata(L, 1, "torch.PerfectHash");
+  const char *filename = luaL_checkstring(L, 2);
+  if(!LHPerfectHash_save(ph, filename))
+    luaL_error(L, "could not save perfect hash into <%s>", filename);
+  return 0;
+}
+
+static int libhash_LHPerfectHash_export(lua_State *L)
+{
+  LHPerfectHash *ph = luaT_checkudata(L, 1, "torch.PerfectHash");
+  const void *buffer = NULL;
+  size_t len = LHPerfectHash_export(ph, &buffer);
+  lua_pushlstring(L, (const char*)buffer, len);
+  return 1;
+}
+
+/* replaces in-place the perfect hash held by the userdata (used by torch.load) */
+static int libhash_LHPerfectHash_import(lua_State *L)
+{
+  LHPerfectHash **udata = NULL;
+  LHPerfectHash *newph = NULL;
+  size_t len = 0;
+  const char *str = NULL;
+  luaT_checkudata(L, 1, "torch.PerfectHash");
+  str = luaL_checklstring(L, 2, &len);
+  newph = LHPerfectHash_import(str, len);
+  if(!newph)
+    luaL_error(L, "invalid or unsupported exported PerfectHash");
+  udata = (LHPerfectHash**)lua_touserdata(L, 1);
+  LHPerfectHash_free(*udata);
+  *udata = newph;
+  lua_pushvalue(L, 1);
+  return 1; /* self */
+}
+
+/* used by torch.factory(), the perfect hash is then filled by read() */
+static int libhash_LHPerfectHash_factory(lua_State *L)
+{
+  LHPerfectHash *ph = LHPerfectHash_new(NULL, 0, 1, 1);
+  luaT_pushudata(L, ph, "torch.PerfectHash");
+  return 1;
+}
+
+static int libhash_LHPerfectHash_free(lua_State *L)
+{
+  LHPerfectHash *ph = luaT_checkudata(L, 1, "torch.PerfectHash");
+  LHPerfectHash_free(ph);
+  return 0;
+}
+
+static const struct luaL_Reg libhash_LHPerfectHash__ [] = {
+  {"lookup", libhash_LHPerfectHash_lookup},
+  {"size", libhash_LHPerfectHash_size},
+  {"save", libhash_LHPerfectHash_save},
+  {"export", libhash_LHPerfectHash_export},
+  {"import", libhash_LHPerfectHash_import},
+  {NULL, NULL}
+};
+
 static const struct luaL_Reg libhash_LHHash__ [] = {
   {"hash", libhash_LHHash_hash},
   {"reset", libhash_LHHash_reset},
   {"update", libhash_LHHash_update},
+  {"updatePtr", libhash_LHHash_updatePtr},
   {"digest", libhash_LHHash_digest},
   {"clone", libhash_LHHash_clone},
+  {"export", libhash_LHHash_export},
+  {"import", libhash_LHHash_import},
+  {"updateAsync", libhash_LHHash_updateAsync},
+  {NULL, NULL}
+};
+
+static const struct luaL_Reg libhash_HashFuture__ [] = {
+  {"wait", libhash_HashFuture_wait},
+  {"ready", libhash_HashFuture_ready},
+  {"digest", libhash_HashFuture_digest},
   {NULL, NULL}
 };
 
@@ -196,6 +1022,12 @@ static const struct luaL_Reg libhash__ [] = {
   {"XXH64", libhash_LHXXH64_new},
   {"FNV64", libhash_LHFNV64_new},
   {"hash", libhash_hash},
+  {"import", libhash_import},
+  {"PerfectHash", libhash_LHPerfectHash_new},
+  {"loadPerfectHash", libhash_LHPerfectHash_load},
+  {"unique", libhash_unique},
+  {"hashAsync", libhash_hashAsync},
+  {"partition", libhash_partition},
   {NULL, NULL}
 };
 
@@ -209,10 +1041,18 @@ int luaopen_libhash(lua_State *L)
   if(!lua_istable(L, -1))
     luaL_error(L, "could not load torch");
 
-  luaT_newmetatable(L, "torch.Hash", NULL, NULL, libhash_LHHash_free, NULL);
+  luaT_newmetatable(L, "torch.Hash", NULL, NULL, libhash_LHHash_free, libhash_LHHash_factory);
   luaL_register(L, NULL, libhash_LHHash__);
   lua_pop(L, 1);
 
+  luaT_newmetatable(L, "torch.HashFuture", NULL, NULL, libhash_HashFuture_free, NULL);
+  luaL_register(L, NULL, libhash_HashFuture__);
+  lua_pop(L, 1);
+
+  luaT_newmetatable(L, "torch.PerfectHash", NULL, NULL, libhash_LHPerfectHash_free, libhash_LHPerfectHash_factory);
+  luaL_register(L, NULL, libhash_LHPerfectHash__);
+  lua_pop(L, 1);
+
   lua_newtable(L);
   luaL_register(L, NULL, libhash__);
 
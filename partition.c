@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "hash.h"
+#include "partition.h"
+
+/*
+  Two-pass radix scatter. Each thread handles a contiguous chunk of rows:
+    1. hash rows, store their partition and count them per partition,
+    2. (after a prefix sum over partitions and threads) scatter row
+       indices into their partition.
+  The scatter goes through small per-partition write-combining buffers
+  (one cache line), flushed when full, when the number of partitions is
+  not too large.
+*/
+
+#define LHPARTITION_WCSIZE     8     /* 64 bytes */
+#define LHPARTITION_WCMAXPARTS 4096
+#define LHPARTITION_MINPARALLEL 65536
+
+static inline unsigned int LHPartition_part(const unsigned char *row, size_t rowsize,
+                                            const size_t *keyoffsets, long nkeys, size_t keysize,
+                                            unsigned char *keys, unsigned long long seed,
+                                            unsigned long long mod, long nparts)
+{
+  unsigned long long h;
+  if(nkeys > 0) {
+    long k;
+    for(k = 0; k < nkeys; k++)
+      memcpy(keys + k*keysize, row + keyoffsets[k], keysize);
+    h = LHXXH64(keys, nkeys*keysize, seed);
+  }
+  else
+    h = LHXXH64(row, rowsize, seed);
+  return (unsigned int)((h % mod) % nparts);
+}
+
+int LHPartition(const void *data_, long n, size_t rowsize,
+                const size_t *keyoffsets, long nkeys, size_t keysize,
+                unsigned long long seed, unsigned long long mod, long nparts,
+                int nthreads, long *perm, long *offsets)
+{
+  const unsigned char *data = (const unsigned char*)data_;
+  int wc = (nparts <= LHPARTITION_WCMAXPARTS);
+  unsigned int *parts = NULL;
+  long *counts = NULL;
+  unsigned char *keys = NULL;
+  long *wcbuffers = NULL;
+  int *wcsizes = NULL;
+  int ok = 0;
+
+#ifdef _OPENMP
+  if(nthreads <= 0)
+    nthreads = omp_get_max_threads();
+  if(n < LHPARTITION_MINPARALLEL)
+    nthreads = 1;
+#else
+  nthreads = 1;
+#endif
+
+  parts = (unsigned int*)malloc(sizeof(unsigned int)*(n+1));
+  counts = (long*)calloc((size_t)nthreads*nparts, sizeof(long));
+  keys = (unsigned char*)malloc((size_t)nthreads*nkeys*keysize+1);
+  if(wc) {
+    wcbuffers = (long*)malloc(sizeof(long)*nthreads*nparts*LHPARTITION_WCSIZE);
+    wcsizes = (int*)malloc(sizeof(int)*nthreads*nparts);
+  }
+  if(!parts || !counts || !keys || (wc && (!wcbuffers || !wcsizes)))
+    goto cleanup;
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthreads)
+#endif
+  {
+#ifdef _OPENMP
+    int t = omp_get_thread_num();
+    int nt = omp_get_num_threads();
+#else
+    int t = 0;
+    int nt = 1;
+#endif
+    long chunk = (n + nt - 1) / nt;
+    long lo = (t*chunk < n ? t*chunk : n);
+    long hi = (lo+chunk < n ? lo+chunk : n);
+    long *tcounts = counts + (size_t)t*nparts;
+    unsigned char *tkeys = keys + (size_t)t*nkeys*keysize;
+    long i, p;
+
+    /* pass 1: histogram */
+    for(i = lo; i < hi; i++) {
+      unsigned int part = LHPartition_part(data + i*rowsize, rowsize, keyoffsets, nkeys, keysize,
+                                           tkeys, seed, mod, nparts);
+      parts[i] = part;
+      tcounts[part]++;
+    }
+
+#ifdef _OPENMP
+#pragma omp barrier
+#pragma omp single
+#endif
+    {
+      /* counts become the start of each (partition, thread) */
+      long offset = 0;
+      int tt;
+      for(p = 0; p < nparts; p++) {
+        offsets[p] = offset;
+        for(tt = 0; tt < nt; tt++) {
+          long count = counts[(size_t)tt*nparts+p];
+          counts[(size_t)tt*nparts+p] = offset;
+          offset += count;
+        }
+      }
+      offsets[nparts] = offset;
+    }
+
+    /* pass 2: scatter */
+    if(wc) {
+      long *buffers = wcbuffers + (size_t)t*nparts*LHPARTITION_WCSIZE;
+      int *sizes = wcsizes + (size_t)t*nparts;
+      memset(sizes, 0, sizeof(int)*nparts);
+      for(i = lo; i < hi; i++) {
+        unsigned int part = parts[i];
+        long *buffer = buffers + (size_t)part*LHPARTITION_WCSIZE;
+        buffer[sizes[part]++] = i;
+        if(sizes[part] == LHPARTITION_WCSIZE) {
+          memcpy(perm + tcounts[part], buffer, sizeof(long)*LHPARTITION_WCSIZE);
+          tcounts[part] += LHPARTITION_WCSIZE;
+          sizes[part] = 0;
+        }
+      }
+      for(p = 0; p < nparts; p++) {
+        if(sizes[p])
+          memcpy(perm + tcounts[p], buffers + (size_t)p*LHPARTITION_WCSIZE, sizeof(long)*sizes[p]);
+      }
+    }
+    else {
+      for(i = lo; i < hi; i++)
+        perm[tcounts[parts[i]]++] = i;
+    }
+  }
+  ok = 1;
+
+cleanup:
+  free(parts);
+  free(counts);
+  free(keys);
+  free(wcbuffers);
+  free(wcsizes);
+  return ok;
+}
@@ -0,0 +1,21 @@
+#ifndef LIBHASH_PARTITION_INC
+#define LIBHASH_PARTITION_INC
+
+#include <stddef.h>   /* size_t */
+
+/*
+  n contiguous rows of rowsize bytes each. Row i goes to partition
+  (XXH64(row, seed) % mod) % nparts. If nkeys > 0, only the nkeys fields
+  of keysize bytes found at the given byte offsets in the row are hashed
+  (in the given order).
+  perm[0..n-1] gets the row indices grouped by partition (rows keep their
+  order within a partition), and offsets[0..nparts] the start of each
+  partition in perm (offsets[nparts] == n). All indices are 0-based.
+  Returns 0 on memory failure.
+*/
+int LHPartition(const void *data, long n, size_t rowsize,
+                const size_t *keyoffsets, long nkeys, size_t keysize,
+                unsigned long long seed, unsigned long long mod, long nparts,
+                int nthreads, long *perm, long *offsets);
+
+#endif
@@ -0,0 +1,386 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "hash.h"
+#include "perfecthash.h"
+
+/*
+  BBHash-like minimal perfect hash function.
+
+  Keys are hashed (with XXH64, level number being the seed) into a bit
+  array of gamma*n bits at each level. Keys falling alone into a bit are
+  done, colliding keys are sent to the next level. Keys remaining after
+  the last level are stored (sorted) in a fallback array. The id of a key
+  is the rank of its bit among all levels.
+
+  The whole structure is stored in a single buffer of 64 bits words:
+    magic|version nkeys nlevels nwords nfallback
+    levelsize[nlevels] (in bits) leveloffset[nlevels] (in words)
+    bits[nwords]
+    ranks[nwords/8+1] (number of bits set before each block of 512 bits)
+    fallback[nfallback]
+*/
+
+#define LHPH_MAGIC        0x4850484cULL /* LHPH */
+#define LHPH_VERSION      1ULL
+#define LHPH_HEADER       5
+#define LHPH_MAXLEVEL     32
+#define LHPH_MINPARALLEL  65536
+
+struct LHPerfectHash_ {
+  unsigned long long *buffer;
+  size_t nbuffer; /* in words */
+  unsigned long long nkeys;
+  unsigned long long nlevels;
+  unsigned long long nwords;
+  unsigned long long nfallback;
+  const unsigned long long *levelsize;
+  const unsigned long long *leveloffset;
+  const unsigned long long *bits;
+  const unsigned long long *ranks;
+  const unsigned long long *fallback;
+};
+
+#ifdef _OPENMP
+#  define LHPH_ATOMIC_OR(ptr, val) __sync_fetch_and_or(ptr, val)
+#else
+static inline unsigned long long LHPH_ATOMIC_OR(unsigned long long *ptr, unsigned long long val)
+{
+  unsigned long long old = *ptr;
+  *ptr = old | val;
+  return old;
+}
+#endif
+
+static inline int LHPH_popcount(unsigned long long x)
+{
+#ifdef __GNUC__
+  return __builtin_popcountll(x);
+#else
+  int n = 0;
+  for(; x; n++)
+    x &= x-1;
+  return n;
+#endif
+}
+
+static int LHPH_nthreads(int nthreads)
+{
+#ifdef _OPENMP
+  return (nthreads > 0 ? nthreads : omp_get_max_threads());
+#else
+  (void)nthreads;
+  return 1;
+#endif
+}
+
+static inline unsigned long long LHPH_position(unsigned long long key, unsigned long long level, unsigned long long size)
+{
+  return LHXXH64(&key, sizeof(key), level) % size;
+}
+
+static int LHPH_compare(const void *a_, const void *b_)
+{
+  unsigned long long a = *(const unsigned long long*)a_;
+  unsigned long long b = *(const unsigned long long*)b_;
+  return (a > b) - (a < b);
+}
+
+unsigned long long LHPerfectHash_key(const void *input, size_t length)
+{
+  return LHXXH64(input, length, 0);
+}
+
+/* takes ownership of buffer on success */
+static LHPerfectHash* LHPerfectHash_wrap(unsigned long long *buffer, size_t nbuffer)
+{
+  LHPerfectHash *ph = NULL;
+  unsigned long long nlevels, nwords, nfallback, l;
+
+  if(nbuffer < LHPH_HEADER || buffer[0] != (LHPH_MAGIC | (LHPH_VERSION << 32)))
+    return NULL;
+
+  nlevels = buffer[2];
+  nwords = buffer[3];
+  nfallback = buffer[4];
+  if(nlevels > LHPH_MAXLEVEL || nwords > nbuffer || nfallback > nbuffer ||
+     LHPH_HEADER + 2*nlevels + nwords + nwords/8+1 + nfallback != nbuffer ||
+     nfallback > buffer[1])
+    return NULL;
+
+  ph = (LHPerfectHash*)malloc(sizeof(LHPerfectHash));
+  if(!ph)
+    return NULL;
+  ph->buffer = buffer;
+  ph->nbuffer = nbuffer;
+  ph->nkeys = buffer[1];
+  ph->nlevels = nlevels;
+  ph->nwords = nwords;
+  ph->nfallback = nfallback;
+  ph->levelsize = buffer + LHPH_HEADER;
+  ph->leveloffset = ph->levelsize + nlevels;
+  ph->bits = ph->leveloffset + nlevels;
+  ph->ranks = ph->bits + nwords;
+  ph->fallback = ph->ranks + nwords/8+1;
+
+  for(l = 0; l < nlevels; l++) {
+    if(ph->levelsize[l] == 0 || ph->levelsize[l] % 64 ||
+       ph->leveloffset[l] > nwords || ph->levelsize[l]/64 > nwords - ph->leveloffset[l]) {
+      free(ph);
+      return NULL;
+    }
+  }
+
+  return ph;
+}
+
+LHPerfectHash* LHPerfectHash_new(const unsigned long long *keys, size_t nkeys, double gamma, int nthreads)
+{
+  unsigned long long levelsize[LHPH_MAXLEVEL];
+  unsigned long long leveloffset[LHPH_MAXLEVEL];
+  unsigned long long *remaining = NULL;
+  unsigned long long *positions = NULL;
+  unsigned long long *bits = NULL;
+  unsigned long long *collisions = NULL;
+  unsigned long long *buffer = NULL;
+  unsigned long long *ranks = NULL;
+  size_t nremaining = nkeys;
+  size_t nwords = 0;
+  size_t nlevels = 0;
+  size_t nbuffer, nplaced, i;
+  LHPerfectHash *ph = NULL;
+
+  if(gamma < 1)
+    gamma = 1;
+  nthreads = LHPH_nthreads(nthreads);
+
+  remaining = (unsigned long long*)malloc(sizeof(unsigned long long)*(nkeys+1));
+  positions = (unsigned long long*)malloc(sizeof(unsigned long long)*(nkeys+1));
+  if(!remaining || !positions)
+    goto cleanup;
+  if(nkeys)
+    memcpy(remaining, keys, sizeof(unsigned long long)*nkeys);
+
+  while(nremaining > 0 && nlevels < LHPH_MAXLEVEL) {
+    unsigned long long size = ((unsigned long long)(gamma*nremaining) + 63) / 64 * 64;
+    size_t lwords = size/64;
+    unsigned long long *level = NULL;
+    unsigned long long *newbits = NULL;
+    long j;
+    size_t n;
+
+    newbits = (unsigned long long*)realloc(bits, sizeof(unsigned long long)*(nwords+lwords));
+    free(collisions);
+    collisions = (unsigned long long*)calloc(lwords, sizeof(unsigned long long));
+    if(!newbits || !collisions)
+      goto cleanup;
+    bits = newbits;
+    level = bits + nwords;
+    memset(level, 0, sizeof(unsigned long long)*lwords);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) if(nremaining >= LHPH_MINPARALLEL)
+#endif
+    for(j = 0; j < (long)nremaining; j++) {
+      unsigned long long pos = LHPH_position(remaining[j], nlevels, size);
+      unsigned long long mask = 1ULL << (pos & 63);
+      positions[j] = pos;
+      if(LHPH_ATOMIC_OR(&level[pos >> 6], mask) & mask)
+        LHPH_ATOMIC_OR(&collisions[pos >> 6], mask);
+    }
+
+    for(i = 0; i < lwords; i++)
+      level[i] &= ~collisions[i];
+
+    /* colliding keys go to the next level */
+    n = 0;
+    for(i = 0; i < nremaining; i++) {
+      unsigned long long pos = positions[i];
+      if(collisions[pos >> 6] & (1ULL << (pos & 63)))
+        remaining[n++] = remaining[i];
+    }
+    nremaining = n;
+
+    levelsize[nlevels] = size;
+    leveloffset[nlevels] = nwords;
+    nwords += lwords;
+    nlevels++;
+  }
+
+  /* fallback: identical keys (fingerprints) always collide, and end up here */
+  qsort(remaining, nremaining, sizeof(unsigned long long), LHPH_compare);
+  for(i = 1; i < nremaining; i++) {
+    if(remaining[i] == remaining[i-1])
+      goto cleanup;
+  }
+
+  nbuffer = LHPH_HEADER + 2*nlevels + nwords + nwords/8+1 + nremaining;
+  buffer = (unsigned long long*)malloc(sizeof(unsigned long long)*nbuffer);
+  if(!buffer)
+    goto cleanup;
+  buffer[0] = LHPH_MAGIC | (LHPH_VERSION << 32);
+  buffer[1] = nkeys;
+  buffer[2] = nlevels;
+  buffer[3] = nwords;
+  buffer[4] = nremaining;
+  if(nlevels) {
+    memcpy(buffer + LHPH_HEADER, levelsize, sizeof(unsigned long long)*nlevels);
+    memcpy(buffer + LHPH_HEADER + nlevels, leveloffset, sizeof(unsigned long long)*nlevels);
+  }
+  if(nwords)
+    memcpy(buffer + LHPH_HEADER + 2*nlevels, bits, sizeof(unsigned long long)*nwords);
+  ranks = buffer + LHPH_HEADER + 2*nlevels + nwords;
+  nplaced = 0;
+  for(i = 0; i < nwords; i++) {
+    if(i % 8 == 0)
+      ranks[i/8] = nplaced;
+    nplaced += LHPH_popcount(bits[i]);
+  }
+  if(nwords % 8 == 0)
+    ranks[nwords/8] = nplaced;
+  if(nremaining)
+    memcpy(ranks + nwords/8+1, remaining, sizeof(unsigned long long)*nremaining);
+
+  if(nplaced + nremaining != nkeys || !(ph = LHPerfectHash_wrap(buffer, nbuffer)))
+    free(buffer);
+
+cleanup:
+  free(remaining);
+  free(positions);
+  free(bits);
+  free(collisions);
+  return ph;
+}
+
+long LHPerfectHash_lookup(LHPerfectHash *ph, unsigned long long key)
+{
+  unsigned long long l;
+  size_t lo, hi;
+
+  for(l = 0; l < ph->nlevels; l++) {
+    unsigned long long pos = ph->leveloffset[l]*64 + LHPH_position(key, l, ph->levelsize[l]);
+    unsigned long long word = pos >> 6;
+    if((ph->bits[word] >> (pos & 63)) & 1) {
+      unsigned long long w;
+      unsigned long long rank = ph->ranks[word >> 3];
+      for(w = word & ~7ULL; w < word; w++)
+        rank += LHPH_popcount(ph->bits[w]);
+      rank += LHPH_popcount(ph->bits[word] & ((1ULL << (pos & 63)) - 1));
+      return (long)rank;
+    }
+  }
+
+  lo = 0;
+  hi = ph->nfallback;
+  while(lo < hi) {
+    size_t mid = lo + (hi-lo)/2;
+    if(ph->fallback[mid] < key)
+      lo = mid+1;
+    else
+      hi = mid;
+  }
+  if(lo < ph->nfallback && ph->fallback[lo] == key)
+    return (long)(ph->nkeys - ph->nfallback + lo);
+
+  return -1;
+}
+
+void LHPerfectHash_lookupBatch(LHPerfectHash *ph, const void *keys, size_t keysize, size_t n, long *ids, int nthreads)
+{
+  const unsigned char *data = (const unsigned char*)keys;
+  long i;
+
+  nthreads = LHPH_nthreads(nthreads);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) if(n >= LHPH_MINPARALLEL)
+#endif
+  for(i = 0; i < (long)n; i++)
+    ids[i] = LHPerfectHash_lookup(ph, LHPerfectHash_key(data + i*keysize, keysize));
+}
+
+size_t LHPerfectHash_size(LHPerfectHash *ph)
+{
+  return (size_t)ph->nkeys;
+}
+
+size_t LHPerfectHash_export(LHPerfectHash *ph, const void **buffer)
+{
+  *buffer = ph->buffer;
+  return ph->nbuffer*sizeof(unsigned long long);
+}
+
+LHPerfectHash* LHPerfectHash_import(const void *buffer_, size_t length)
+{
+  unsigned long long *buffer = NULL;
+  LHPerfectHash *ph = NULL;
+
+  if(length % sizeof(unsigned long long) || length == 0)
+    return NULL;
+
+  buffer = (unsigned long long*)malloc(length);
+  if(!buffer)
+    return NULL;
+  memcpy(buffer, buffer_, length);
+  ph = LHPerfectHash_wrap(buffer, length/sizeof(unsigned long long));
+  if(!ph)
+    free(buffer);
+  return ph;
+}
+
+int LHPerfectHash_save(LHPerfectHash *ph, const char *filename)
+{
+  FILE *f = fopen(filename, "wb");
+  int ok = 0;
+  if(!f)
+    return 0;
+  ok = (fwrite(ph->buffer, sizeof(unsigned long long), ph->nbuffer, f) == ph->nbuffer);
+  ok = (fclose(f) == 0) && ok;
+  return ok;
+}
+
+/* the file is read with two fread() calls: header, then everything else */
+LHPerfectHash* LHPerfectHash_load(const char *filename)
+{
+  unsigned long long header[LHPH_HEADER];
+  unsigned long long *buffer = NULL;
+  unsigned long long nbuffer;
+  LHPerfectHash *ph = NULL;
+  FILE *f = fopen(filename, "rb");
+
+  if(!f)
+    return NULL;
+
+  if(fread(header, sizeof(unsigned long long), LHPH_HEADER, f) != LHPH_HEADER ||
+     header[0] != (LHPH_MAGIC | (LHPH_VERSION << 32)) || header[2] > LHPH_MAXLEVEL)
+    goto cleanup;
+
+  nbuffer = LHPH_HEADER + 2*header[2] + header[3] + header[3]/8+1 + header[4];
+  if(nbuffer < header[3] || nbuffer < header[4] || nbuffer > ((size_t)-1)/sizeof(unsigned long long))
+    goto cleanup;
+  buffer = (unsigned long long*)malloc(sizeof(unsigned long long)*nbuffer);
+  if(!buffer)
+    goto cleanup;
+  memcpy(buffer, header, sizeof(header));
+  if(fread(buffer + LHPH_HEADER, sizeof(unsigned long long), nbuffer-LHPH_HEADER, f) != nbuffer-LHPH_HEADER)
+    goto cleanup;
+
+  ph = LHPerfectHash_wrap(buffer, nbuffer);
+
+cleanup:
+  if(!ph)
+    free(buffer);
+  fclose(f);
+  return ph;
+}
+
+void LHPerfectHash_free(LHPerfectHash *ph)
+{
+  free(ph->buffer);
+  free(ph);
+}
@@ -0,0 +1,29 @@
+#ifndef LIBHASH_PERFECTHASH_INC
+#define LIBHASH_PERFECTHASH_INC
+
+#include <stddef.h>   /* size_t */
+
+typedef struct LHPerfectHash_ LHPerfectHash;
+
+/* 64 bits fingerprint of a key, to be given to new() and lookup() */
+unsigned long long LHPerfectHash_key(const void *input, size_t length);
+
+/* returns NULL if two keys are identical (or on memory failure) */
+/* nthreads <= 0 means all available threads */
+LHPerfectHash* LHPerfectHash_new(const unsigned long long *keys, size_t nkeys, double gamma, int nthreads);
+
+/* returns an id in [0, nkeys-1] (any id for unknown keys), or -1 if the key is known to be missing */
+long LHPerfectHash_lookup(LHPerfectHash *ph, unsigned long long key);
+/* keys are n contiguous keys of keysize bytes each */
+void LHPerfectHash_lookupBatch(LHPerfectHash *ph, const void *keys, size_t keysize, size_t n, long *ids, int nthreads);
+size_t LHPerfectHash_size(LHPerfectHash *ph);
+
+/* the exported layout is the in-memory layout, it may be read back with a single read */
+size_t LHPerfectHash_export(LHPerfectHash *ph, const void **buffer);
+LHPerfectHash* LHPerfectHash_import(const void *buffer, size_t length);
+int LHPerfectHash_save(LHPerfectHash *ph, const char *filename);
+LHPerfectHash* LHPerfectHash_load(const char *filename);
+
+void LHPerfectHash_free(LHPerfectHash *ph);
+
+#endif
@@ -0,0 +1,260 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "hash.h"
+#include "unique.h"
+
+/*
+  Each row gets a representative (the index of its first occurrence),
+  found with an open-addressing (linear probing) hash table of rows
+  hashed with XXH64. Rows are compared on hash collision.
+
+  A table slot is 8 bytes: the row index (plus one, 0 meaning empty) in
+  the low idxbits bits, and the high bits of the row hash above it. The
+  table starts small and doubles as unique rows are found (row hashes
+  being recomputed, if not given), so memory depends on the number of
+  unique rows, not on the number of rows.
+
+  In parallel mode, rows are first partitioned (stable counting sort)
+  on the high bits of their hash, and each partition is handled by its
+  own hash table.
+
+  A final linear pass numbers the representatives in order.
+*/
+
+typedef struct {
+  unsigned long long *slots;
+  unsigned long long mask;
+  size_t count;
+  int idxbits;
+  const unsigned char *data;
+  size_t rowsize;
+  const unsigned long long *hashes; /* row hashes, or NULL (recomputed) */
+} LHUniqueTable;
+
+#define LHUNIQUE_MINPARALLEL 65536
+#define LHUNIQUE_PREFETCH 16
+#define LHUNIQUE_INITSIZE 1024
+
+#ifdef __GNUC__
+#  define LHUNIQUE_PREFETCHSLOT(ptr) __builtin_prefetch(ptr)
+#else
+#  define LHUNIQUE_PREFETCHSLOT(ptr)
+#endif
+
+static unsigned long long LHUnique_hash(const LHUniqueTable *table, long i)
+{
+  if(table->hashes)
+    return table->hashes[i];
+  return LHXXH64(table->data + i*table->rowsize, table->rowsize, 0);
+}
+
+/* n is the number of rows, nmax the largest row index (+1) */
+static int LHUnique_initTable(LHUniqueTable *table, long n, long nmax,
+                              const unsigned char *data, size_t rowsize,
+                              const unsigned long long *hashes)
+{
+  size_t size = 16;
+
+  while(size < LHUNIQUE_INITSIZE && size < (size_t)n + (size_t)n/2)
+    size *= 2;
+  table->slots = (unsigned long long*)calloc(size, sizeof(unsigned long long));
+  table->mask = size-1;
+  table->count = 0;
+  table->idxbits = 1;
+  while(table->idxbits < 63 && (1ULL << table->idxbits) <= (unsigned long long)nmax)
+    table->idxbits++;
+  table->data = data;
+  table->rowsize = rowsize;
+  table->hashes = hashes;
+  return table->slots != NULL;
+}
+
+static int LHUnique_growTable(LHUniqueTable *table)
+{
+  size_t size = 2*(table->mask+1);
+  unsigned long long idxmask = (1ULL << table->idxbits)-1;
+  unsigned long long *slots = (unsigned long long*)calloc(size, sizeof(unsigned long long));
+  size_t i;
+
+  if(!slots)
+    return 0;
+  for(i = 0; i <= table->mask; i++) {
+    unsigned long long entry = table->slots[i];
+    if(entry) {
+      unsigned long long slot = LHUnique_hash(table, (long)(entry & idxmask)-1) & (size-1);
+      while(slots[slot])
+        slot = (slot+1) & (size-1);
+      slots[slot] = entry;
+    }
+  }
+  free(table->slots);
+  table->slots = slots;
+  table->mask = size-1;
+  return 1;
+}
+
+/* returns the representative of row i (or -1 on memory failure) */
+static inline long LHUnique_insert(LHUniqueTable *table, long i, unsigned long long hash)
+{
+  unsigned long long idxmask = (1ULL << table->idxbits)-1;
+  unsigned long long slot = hash & table->mask;
+  size_t rowsize = table->rowsize;
+  for(;;) {
+    unsigned long long entry = table->slots[slot];
+    if(!entry)
+      break;
+    if(!((entry ^ hash) & ~idxmask)) {
+      long index = (long)(entry & idxmask)-1;
+      if(!memcmp(table->data + index*rowsize, table->data + i*rowsize, rowsize))
+        return index;
+    }
+    slot = (slot+1) & table->mask;
+  }
+
+  /* new unique row: keep the load factor under 2/3 */
+  if(3*(table->count+1) > 2*(table->mask+1)) {
+    if(!LHUnique_growTable(table))
+      return -1;
+    slot = hash & table->mask;
+    while(table->slots[slot])
+      slot = (slot+1) & table->mask;
+  }
+  table->slots[slot] = (hash & ~idxmask) | (unsigned long long)(i+1);
+  table->count++;
+  return i;
+}
+
+static int LHUnique_serial(const unsigned char *data, long n, size_t rowsize, long *rep)
+{
+  LHUniqueTable table;
+  unsigned long long hashes[LHUNIQUE_PREFETCH];
+  long i;
+
+  if(!LHUnique_initTable(&table, n, n, data, rowsize, NULL))
+    return 0;
+
+  /* hashes are computed ahead, to prefetch their slot */
+  for(i = 0; i < n && i < LHUNIQUE_PREFETCH; i++) {
+    hashes[i] = LHXXH64(data + i*rowsize, rowsize, 0);
+    LHUNIQUE_PREFETCHSLOT(&table.slots[hashes[i] & table.mask]);
+  }
+  for(i = 0; i < n; i++) {
+    unsigned long long hash = hashes[i % LHUNIQUE_PREFETCH];
+    if(i + LHUNIQUE_PREFETCH < n) {
+      unsigned long long next = LHXXH64(data + (i+LHUNIQUE_PREFETCH)*rowsize, rowsize, 0);
+      hashes[i % LHUNIQUE_PREFETCH] = next;
+      LHUNIQUE_PREFETCHSLOT(&table.slots[next & table.mask]);
+    }
+    rep[i] = LHUnique_insert(&table, i, hash);
+    if(rep[i] < 0) {
+      free(table.slots);
+      return 0;
+    }
+  }
+
+  free(table.slots);
+  return 1;
+}
+
+static int LHUnique_parallel(const unsigned char *data, long n, size_t rowsize, long *rep, int nthreads)
+{
+  unsigned long long *hashes = (unsigned long long*)malloc(sizeof(unsigned long long)*n);
+  long *order = (long*)malloc(sizeof(long)*n);
+  long offsets[257];
+  int nbits = 0;
+  int nparts, p;
+  long i;
+  int ok = 1;
+
+  while((1 << nbits) < 4*nthreads && nbits < 8)
+    nbits++;
+  nparts = 1 << nbits;
+
+  if(!hashes || !order) {
+    free(hashes);
+    free(order);
+    return 0;
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads)
+#endif
+  for(i = 0; i < n; i++)
+    hashes[i] = LHXXH64(data + i*rowsize, rowsize, 0);
+
+  /* stable counting sort on the high bits of the hash */
+  memset(offsets, 0, sizeof(offsets));
+  for(i = 0; i < n; i++)
+    offsets[(hashes[i] >> (64-nbits))+1]++;
+  for(p = 0; p < nparts; p++)
+    offsets[p+1] += offsets[p];
+  for(i = 0; i < n; i++)
+    order[offsets[hashes[i] >> (64-nbits)]++] = i;
+  for(p = nparts; p > 0; p--)
+    offsets[p] = offsets[p-1];
+  offsets[0] = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic, 1) reduction(&&:ok)
+#endif
+  for(p = 0; p < nparts; p++) {
+    LHUniqueTable table;
+    long j;
+    if(!LHUnique_initTable(&table, offsets[p+1]-offsets[p], n, data, rowsize, hashes)) {
+      ok = 0;
+      continue;
+    }
+    for(j = offsets[p]; j < offsets[p+1] && ok; j++) {
+      long k = order[j];
+      rep[k] = LHUnique_insert(&table, k, hashes[k]);
+      if(rep[k] < 0)
+        ok = 0;
+    }
+    free(table.slots);
+  }
+
+  free(hashes);
+  free(order);
+  return ok;
+}
+
+long LHUnique(const void *data, long n, size_t rowsize, long *first, long *inverse, long *counts, int nthreads)
+{
+  long nunique = 0;
+  long i;
+  int ok;
+
+#ifdef _OPENMP
+  if(nthreads <= 0)
+    nthreads = omp_get_max_threads();
+#else
+  nthreads = 1;
+#endif
+
+  /* inverse first holds representatives */
+  if(nthreads > 1 && n >= LHUNIQUE_MINPARALLEL)
+    ok = LHUnique_parallel((const unsigned char*)data, n, rowsize, inverse, nthreads);
+  else
+    ok = LHUnique_serial((const unsigned char*)data, n, rowsize, inverse);
+  if(!ok)
+    return -1;
+
+  /* representatives always come first, and get their id in order */
+  for(i = 0; i < n; i++) {
+    if(inverse[i] == i) {
+      first[nunique] = i;
+      counts[nunique] = 0;
+      inverse[i] = nunique++;
+    }
+    else
+      inverse[i] = inverse[inverse[i]];
+    counts[inverse[i]]++;
+  }
+
+  return nunique;
+}
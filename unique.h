@@ -0,0 +1,17 @@
+#ifndef LIBHASH_UNIQUE_INC
+#define LIBHASH_UNIQUE_INC
+
+#include <stddef.h>   /* size_t */
+
+/*
+  n contiguous rows of rowsize bytes each (rows are compared bitwise).
+  Returns the number k of unique rows (in order of first occurrence), or -1
+  on memory failure.
+  first[0..k-1] gets the index of the first occurrence of each unique row,
+  counts[0..k-1] its number of occurrences, and inverse[0..n-1] the unique
+  row id of each row. first and counts must be able to hold n entries.
+  All indices are 0-based. nthreads > 1 enables the partitioned parallel mode.
+*/
+long LHUnique(const void *data, long n, size_t rowsize, long *first, long *inverse, long *counts, int nthreads);
+
+#endif
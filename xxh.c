@@ -420,14 +420,62 @@ static LHHash* XXH64_clone(LHHash *state)
   return newstate;
 }
 
+/*
+  seed, total_len, v1, v2, v3, v4 (8 bytes each), memsize (1 byte),
+  followed by the memsize bytes still pending in memory
+*/
+static size_t XXH64_export(LHHash *state_in, unsigned char *buffer)
+{
+  XXH64_state_t *state = (XXH64_state_t*)state_in;
+  if(buffer) {
+    LHHash_writeU64(buffer,    state->seed);
+    LHHash_writeU64(buffer+8,  state->total_len);
+    LHHash_writeU64(buffer+16, state->v1);
+    LHHash_writeU64(buffer+24, state->v2);
+    LHHash_writeU64(buffer+32, state->v3);
+    LHHash_writeU64(buffer+40, state->v4);
+    buffer[48] = (BYTE)state->memsize;
+    memcpy(buffer+49, state->memory, state->memsize);
+  }
+  return 49 + state->memsize;
+}
+
+static int XXH64_import(LHHash *state_in, const unsigned char *buffer, size_t len)
+{
+  XXH64_state_t *state = (XXH64_state_t*)state_in;
+  if(len < 49 || buffer[48] >= 32 || len != 49 + (size_t)buffer[48])
+    return 0;
+  state->seed      = LHHash_readU64(buffer);
+  state->total_len = LHHash_readU64(buffer+8);
+  state->v1        = LHHash_readU64(buffer+16);
+  state->v2        = LHHash_readU64(buffer+24);
+  state->v3        = LHHash_readU64(buffer+32);
+  state->v4        = LHHash_readU64(buffer+40);
+  state->memsize   = buffer[48];
+  memcpy(state->memory, buffer+49, state->memsize);
+  return 1;
+}
+
 static struct LHHashVTable LHXXH64VTable = {
   XXH64_reset,
   XXH64_update,
   XXH64_digest,
   XXH64_clone,
-  XXH64_free
+  XXH64_free,
+  XXH64_export,
+  XXH64_import,
+  LHHASH_XXH64
 };
 
+unsigned long long LHXXH64(const void* input, size_t length, unsigned long long seed)
+{
+  XXH64_state_t state;
+  state.vtable = &LHXXH64VTable;
+  XXH64_reset((LHHash*)&state, seed);
+  XXH64_update((LHHash*)&state, input, length);
+  return XXH64_digest((LHHash*)&state);
+}
+
 LHHash* LHXXH64_new(void)
 {
   LHHash *state = (LHHash*)malloc(sizeof(XXH64_state_t));